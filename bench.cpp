@@ -0,0 +1,327 @@
+/*
+        Benchmarks for the simulation and the Borel set code, every scenario
+        seeded so two runs do the same work, one csv row per measurement
+
+                bench [results.csv] [--quick]
+
+        columns are
+
+                benchmark,variant,paths,steps,threads,size,repeats,median_seconds,min_seconds,items_per_second
+
+        where an item is whatever the benchmark counts (a path step, a
+        normal, a view read, a cell rendered, a call), so diffing the csv
+        of two builds compares them. Time is only taken around the work
+        itself, never the setup. Build it as Release, the default flags
+        have no optimization
+ */
+#include "proc.cpp"
+
+#include <sstream>
+
+namespace Bench{
+
+        // accumulates the time between each Start() and Stop()
+        struct Stopwatch{
+                void Start(){ start_ = std::chrono::steady_clock::now(); }
+                void Stop(){ seconds_ += std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count(); }
+                double Seconds()const{ return seconds_; }
+        private:
+                std::chrono::steady_clock::time_point start_;
+                double seconds_{0.0};
+        };
+
+        struct Scenario{
+                std::string benchmark;
+                std::string variant;
+                size_t paths;
+                size_t steps;
+                size_t threads;
+                size_t size;
+                // items per repeat
+                double items;
+        };
+
+        struct Suite{
+                Suite(std::ostream& out, size_t repeats)
+                        :out_(&out), repeats_(repeats)
+                {
+                        *out_ << "benchmark,variant,paths,steps,threads,size,repeats,median_seconds,min_seconds,items_per_second\n";
+                }
+                // body does its own setup, timing only the work on the stopwatch
+                void Run(Scenario const& s, std::function<void(Stopwatch&)> const& body){
+                        std::vector<double> seconds;
+                        for(size_t idx=0;idx!=repeats_;++idx){
+                                Stopwatch sw;
+                                body(sw);
+                                seconds.push_back(sw.Seconds());
+                        }
+                        std::sort(seconds.begin(), seconds.end());
+                        double median = seconds[seconds.size() / 2];
+                        *out_ << s.benchmark << "," << s.variant << ","
+                              << s.paths << "," << s.steps << "," << s.threads << "," << s.size << ","
+                              << repeats_ << "," << median << "," << seconds.front() << ","
+                              << ( median > 0.0 ? s.items / median : 0.0 ) << "\n";
+                        out_->flush();
+                        std::cerr << s.benchmark << " " << s.variant << " paths=" << s.paths << " steps=" << s.steps
+                                  << " threads=" << s.threads << " size=" << s.size << " : " << median << "s\n";
+                }
+        private:
+                std::ostream* out_;
+                size_t repeats_;
+        };
+
+        /*
+                each adds its integrals to the context, the bank account
+                needs the short rate it is paired with stepped too
+         */
+        inline std::vector<std::pair<std::string, std::function<void(ProcessContext&, size_t)> > > Differentials(){
+                auto simple = [](std::function<std::shared_ptr<Differential>()> make, double x){
+                        return [make, x](ProcessContext& ctx, size_t paths){
+                                auto dx = make();
+                                for(size_t idx=0;idx!=paths;++idx){
+                                        ProcessIntegral(ctx, x, dx);
+                                }
+                        };
+                };
+                std::vector<std::pair<std::string, std::function<void(ProcessContext&, size_t)> > > result;
+                result.emplace_back("identity", simple([](){ return std::make_shared<IdentityDifferential>(); }, 0.0));
+                result.emplace_back("gbm_euler", simple([](){ return std::make_shared<GeometricBrownianMotionWithDriftDifferential>(10.0, 0.02, 0.1); }, 10.0));
+                result.emplace_back("gbm_exact", simple([](){ return std::make_shared<GeometricBrownianMotionWithDriftDifferential>(10.0, 0.02, 0.1, StepScheme::Exact); }, 10.0));
+                result.emplace_back("vasicek_euler", simple([](){ return std::make_shared<VasicekDifferential>(0.1, 2.0, 0.1); }, 0.05));
+                result.emplace_back("vasicek_exact", simple([](){ return std::make_shared<VasicekDifferential>(0.1, 2.0, 0.1, StepScheme::Exact); }, 0.05));
+                result.emplace_back("cir_euler", simple([](){ return std::make_shared<CoxIngersollRos>(0.1, 2.0, 0.1); }, 0.05));
+                result.emplace_back("cir_exact", simple([](){ return std::make_shared<CoxIngersollRos>(0.1, 2.0, 0.1, StepScheme::Exact); }, 0.05));
+                result.emplace_back("paired_bank_account", [](ProcessContext& ctx, size_t paths){
+                        auto rate = std::make_shared<VasicekDifferential>(0.1, 2.0, 0.1);
+                        auto bank = std::make_shared<PairedBankAccountDifferential>(ctx.Batch(rate));
+                        for(size_t idx=0;idx!=paths;++idx){
+                                ProcessIntegral(ctx, 0.05, rate);
+                                ProcessIntegral(ctx, 1.0, bank);
+                        }
+                });
+                return result;
+        }
+
+        inline void SetThreads(ProcessContext& ctx, size_t threads){
+                if( threads > 1 )
+                        ctx.SetPool(std::make_shared<WorkStealingPool>(threads));
+        }
+
+        // ProcessContext::Step, normals and differential together
+        inline void StepThroughput(Suite& suite, std::vector<size_t> const& paths, std::vector<size_t> const& steps, std::vector<size_t> const& threads){
+                for(auto const& dx : Differentials()){
+                        for(auto p : paths){
+                                for(auto n : steps){
+                                        for(auto t : threads){
+                                                suite.Run(Scenario{"step", dx.first, p, n, t, 0, static_cast<double>(p * n)}, [&](Stopwatch& sw){
+                                                        ProcessContext ctx;
+                                                        SetThreads(ctx, t);
+                                                        dx.second(ctx, p);
+                                                        sw.Start();
+                                                        for(size_t idx=0;idx!=n;++idx){
+                                                                ctx.Step(1.0 / n);
+                                                        }
+                                                        sw.Stop();
+                                                });
+                                        }
+                                }
+                        }
+                }
+        }
+
+        // GenerateNormals alone, per generator
+        inline void NormalGeneration(Suite& suite, std::vector<size_t> const& paths, size_t steps, std::vector<size_t> const& threads){
+                std::vector<std::string> generators{"philox", "threefry", "sobol"};
+                for(auto const& name : generators){
+                        for(auto p : paths){
+                                for(auto t : threads){
+                                        suite.Run(Scenario{"normals", name, p, steps, t, 0, static_cast<double>(p * steps)}, [&](Stopwatch& sw){
+                                                ProcessContext ctx;
+                                                SetThreads(ctx, t);
+                                                auto gbm = std::make_shared<GeometricBrownianMotionWithDriftDifferential>(10.0, 0.02, 0.1);
+                                                for(size_t idx=0;idx!=p;++idx){
+                                                        ProcessIntegral(ctx, 10.0, gbm);
+                                                }
+                                                if( name == "threefry" )
+                                                        ctx.SetGenerator(std::make_shared<ThreefryNormalGenerator>(0));
+                                                if( name == "sobol" )
+                                                        ctx.SetGenerator(std::make_shared<SobolBridgeGenerator>(std::vector<uint32_t>{ctx.Stream(gbm)}, steps, p));
+                                                for(size_t idx=0;idx!=steps;++idx){
+                                                        sw.Start();
+                                                        ctx.GenerateNormals();
+                                                        sw.Stop();
+                                                        ctx.Evolve(1.0 / steps);
+                                                }
+                                        });
+                                }
+                        }
+                }
+        }
+
+        // an AverageView over an Option per path, read once per step
+        inline void ViewEvaluation(Suite& suite, std::vector<size_t> const& paths, size_t steps){
+                for(auto p : paths){
+                        suite.Run(Scenario{"views", "average_option", p, steps, 1, 0, static_cast<double>(p * steps)}, [&](Stopwatch& sw){
+                                ProcessContext ctx;
+                                auto gbm = std::make_shared<GeometricBrownianMotionWithDriftDifferential>(10.0, 0.02, 0.1);
+                                AverageView avg;
+                                for(size_t idx=0;idx!=p;++idx){
+                                        avg.Add(Option(std::make_shared<ProcessIntegral>(ctx, 10.0, gbm), 15.0));
+                                }
+                                double sink = 0.0;
+                                for(size_t idx=0;idx!=steps;++idx){
+                                        ctx.Step(1.0 / steps);
+                                        sw.Start();
+                                        sink += avg.Value();
+                                        sw.Stop();
+                                }
+                                if( sink != sink )
+                                        std::cerr << "nan\n";
+                        });
+                }
+        }
+
+        /*
+                a row per step of the time, the average and the first
+                columns paths, into memory so the disk isn't measured
+         */
+        template<class Renderer>
+        void RenderRows(Suite& suite, char const* variant, size_t paths, size_t steps, std::vector<size_t> const& columns){
+                for(auto c : columns){
+                        suite.Run(Scenario{"renderer", variant, paths, steps, 1, c, static_cast<double>(steps * ( c + 2 ))}, [&](Stopwatch& sw){
+                                ProcessContext ctx;
+                                auto gbm = std::make_shared<GeometricBrownianMotionWithDriftDifferential>(10.0, 0.02, 0.1);
+                                std::vector<ProcessView> views;
+                                views.push_back(std::make_shared<ProcessIntegral>(ctx, 0.0, std::make_shared<IdentityDifferential>()));
+                                AverageView avg;
+                                views.push_back(avg);
+                                for(size_t idx=0;idx!=paths;++idx){
+                                        ProcessView s = std::make_shared<ProcessIntegral>(ctx, 10.0, gbm);
+                                        avg.Add(s);
+                                        if( idx < c )
+                                                views.push_back(s);
+                                }
+                                std::ostringstream out;
+                                Renderer renderer(out, views);
+                                for(size_t idx=0;idx!=steps;++idx){
+                                        ctx.Step(1.0 / steps);
+                                        sw.Start();
+                                        renderer.RenderLine();
+                                        sw.Stop();
+                                }
+                                sw.Start();
+                                renderer.Emit();
+                                sw.Stop();
+                        });
+                }
+        }
+
+        // n intervals with seeded random end points, [a,b) or [a,b]
+        inline std::vector<BorelSet> RandomIntervals(size_t n, uint32_t seed){
+                std::mt19937 gen(seed);
+                std::uniform_real_distribution<double> u(0.0, 1.0);
+                std::vector<BorelSet> result;
+                for(size_t idx=0;idx!=n;++idx){
+                        double a = u(gen);
+                        double b = u(gen);
+                        if( b < a )
+                                std::swap(a, b);
+                        if( idx % 2 == 0 )
+                                result.push_back(Interval{ Closed(a), Open(b) });
+                        else
+                                result.push_back(Interval{ Closed(a), Closed(b) });
+                }
+                return result;
+        }
+
+        // a union of intersections of pairs, and the complement of some
+        inline void BorelSets(Suite& suite, std::vector<size_t> const& sizes, std::vector<size_t> const& family_sizes){
+                enum{ Calls = 200 };
+                for(auto n : sizes){
+                        auto intervals = RandomIntervals(2 * n, 1);
+                        Union u;
+                        for(size_t idx=0;idx!=n;++idx){
+                                BorelSet both = Intersection{ intervals[2 * idx], intervals[2 * idx + 1] };
+                                if( idx % 3 == 0 )
+                                        u.children.push_back(Not{both});
+                                else
+                                        u.children.push_back(both);
+                        }
+                        BorelSet b = std::move(u);
+                        suite.Run(Scenario{"to_intervals", "union_of_intersections", 0, 0, 1, n, static_cast<double>(Calls)}, [&](Stopwatch& sw){
+                                size_t sink = 0;
+                                sw.Start();
+                                for(size_t idx=0;idx!=Calls;++idx){
+                                        sink += ToIntervals(b).children.size();
+                                }
+                                sw.Stop();
+                                if( sink == 0 )
+                                        std::cerr << "empty\n";
+                        });
+                }
+                // a partition of [0,1] into n, whose sigma algebra has 2^n sets
+                for(auto n : family_sizes){
+                        BorelFamily family{ Omega(), Nul() };
+                        for(size_t idx=0;idx!=n;++idx){
+                                double a = static_cast<double>(idx) / n;
+                                double b = static_cast<double>(idx + 1) / n;
+                                if( idx + 1 == n )
+                                        family.push_back(Interval{ Closed(a), Closed(b) });
+                                else
+                                        family.push_back(Interval{ Closed(a), Open(b) });
+                        }
+                        suite.Run(Scenario{"sigma_algebra", "partition", 0, 0, 1, n, 1.0}, [&](Stopwatch& sw){
+                                sw.Start();
+                                auto sigma = GenerateSigmaAlgebra(family);
+                                sw.Stop();
+                                if( sigma.empty() )
+                                        std::cerr << "empty\n";
+                        });
+                }
+        }
+
+        inline std::vector<size_t> ThreadCounts(bool quick){
+                size_t hw = std::max<size_t>(1, std::thread::hardware_concurrency());
+                std::vector<size_t> result{1};
+                for(size_t t=2;t<=hw && ! quick;t*=2){
+                        result.push_back(t);
+                }
+                if( result.back() != hw )
+                        result.push_back(hw);
+                return result;
+        }
+
+} // end namespace Bench
+
+int main(int argc, char** argv){
+        bool quick = false;
+        std::string path = "bench.csv";
+        for(int idx=1;idx<argc;++idx){
+                std::string arg = argv[idx];
+                if( arg == "--quick" )
+                        quick = true;
+                else
+                        path = arg;
+        }
+        std::ofstream out(path);
+        if( ! out ){
+                std::cerr << "can't open " << path << "\n";
+                return 1;
+        }
+        Bench::Suite suite(out, quick ? 1 : 5);
+        auto threads = Bench::ThreadCounts(quick);
+
+        std::vector<size_t> paths = quick ? std::vector<size_t>{1000, 100000} : std::vector<size_t>{1000, 10000, 100000, 1000000};
+        std::vector<size_t> steps = quick ? std::vector<size_t>{20} : std::vector<size_t>{10, 100};
+
+        Bench::StepThroughput(suite, paths, steps, threads);
+        Bench::NormalGeneration(suite, paths, 20, threads);
+        Bench::ViewEvaluation(suite, paths, 20);
+        std::vector<size_t> columns = quick ? std::vector<size_t>{10} : std::vector<size_t>{10, 100, 1000};
+        Bench::RenderRows<ProcessViewRenderer>(suite, "table", 1000, 250, columns);
+        Bench::RenderRows<StreamingProcessViewRenderer>(suite, "streaming", 1000, 250, columns);
+        Bench::BorelSets(suite,
+                         quick ? std::vector<size_t>{4, 16} : std::vector<size_t>{4, 16, 64, 256},
+                         quick ? std::vector<size_t>{2, 4} : std::vector<size_t>{2, 4, 6, 8});
+        std::cerr << "written to " << path << "\n";
+}